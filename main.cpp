@@ -8,6 +8,7 @@
 
 #include "boolean.h"
 #include "interaction.h"
+#include "mesh.h"
 #include "model.h"
 #include "render.h"
 #include "vector3.h"
@@ -18,6 +19,38 @@ void init_camera(void){
 }
 
 int main(int argc, char **argv){
+    // model creation TODO: separate function
+    // Model model;
+    // Torus torus = Torus(1, 0.3);
+    Sphere sphere = Sphere(Vector3(0, 0, 0), 1);
+    Rectangular rect = Rectangular(Vector3(0, 0, 0), 0.5, 1, 1.5);
+    // Quadric quad = Quadric(1, 2, 3, 0, 0, 0, 0, 0, 0, -1);
+    Difference model = Difference(&rect, &sphere);
+
+    // mesh export: ./function_renderer --mesh <path.ply|path.stl> [depth]
+    if(argc >= 3 && std::string(argv[1]) == "--mesh"){
+        const std::string mesh_path = argv[2];
+        int depth = (argc >= 4) ? std::stoi(argv[3]) : 8;
+        bool stl = mesh_path.size() >= 4 && mesh_path.substr(mesh_path.size() - 4) == ".stl";
+        long n = extract_mesh(model, Vector3(-2, -2, -2), Vector3(2, 2, 2), depth, mesh_path,
+            stl ? MESH_STL : MESH_PLY, true);
+        return n < 0 ? 1 : 0;
+    }
+
+    const std::string matcap_path = "matcap/green.png";  // Takikawa et al. 2021
+    cv::Mat matcap_img = cv::imread(matcap_path, -1);
+    assert(!matcap_img.empty());
+
+    // batch rendering from 26 canonical viewpoints: ./function_renderer --views <path.png> [size]
+    if(argc >= 3 && std::string(argv[1]) == "--views"){
+        int size = (argc >= 4) ? std::stoi(argv[3]) : 256;
+        std::vector<Camera> cameras = canonical_cameras(Vector3(0, 0, 0), Vector3(3, 3, 3).norm());
+        std::vector<cv::Mat> images;
+        render_views(images, cameras, model, matcap_img, size, size, true);
+        cv::imwrite(argv[2], contact_sheet(images, 6));
+        return 0;
+    }
+
     int width, height;
     if(argc == 3){
         width = std::stoi(argv[1]);
@@ -32,20 +65,9 @@ int main(int argc, char **argv){
     }
 
     cv::Mat image(cv::Size(width, height), CV_8UC3);
-    const std::string matcap_path = "matcap/green.png";  // Takikawa et al. 2021
-    cv::Mat matcap_img = cv::imread(matcap_path, -1);
-    assert(!matcap_img.empty());
 
     init_camera();
 
-    // model creation TODO: separate function
-    // Model model;
-    // Torus torus = Torus(1, 0.3);
-    Sphere sphere = Sphere(Vector3(0, 0, 0), 1);
-    Rectangular rect = Rectangular(Vector3(0, 0, 0), 0.5, 1, 1.5);
-    // Quadric quad = Quadric(1, 2, 3, 0, 0, 0, 0, 0, 0, -1);
-    Difference model = Difference(&rect, &sphere);
-
     TracerData tracer_data = { &image, &model, &matcap_img };
     render(image, model, matcap_img, true);
 
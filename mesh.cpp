@@ -0,0 +1,313 @@
+/*
+    Triangle mesh extraction from any Model, for the tools which need polygonal meshes (FEA, collision, ...)
+        1. the bounding cube is divided into bricks, each brick is an adaptive octree
+           which descends only into cells whose |SDF| at the center is below the cell diagonal
+        2. each leaf cell is split into 6 tetrahedra sharing the main diagonal (marching tetrahedra),
+           surface vertices are created on the tetrahedron edges and deduplicated by the edge key
+        3. each vertex is refined by one Newton step along Model::normal
+        4. bricks of one z-layer are polygonized in parallel with OpenMP, each into its own arena,
+           then merged in order and streamed into binary PLY/STL, so only one layer is held in memory
+    Marching tetrahedra is used instead of the marching cubes table, its face diagonals match between
+    neighboring cells, so the mesh has no cracks and no ambiguous cases
+*/
+
+#include <assert.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <omp.h>
+
+#include "mesh.h"
+
+const int BRICK_DEPTH = 4;
+// corner k of a cell is (k & 1, (k >> 1) & 1, (k >> 2) & 1)
+const int TETRAHEDRA[6][4] = {
+    {0, 7, 1, 3}, {0, 7, 3, 2}, {0, 7, 2, 6}, {0, 7, 6, 4}, {0, 7, 4, 5}, {0, 7, 5, 1}
+};
+
+struct MeshGrid {
+    Vector3 o;
+    double h;
+};
+
+struct MeshArena {
+    long lo[3], hi[3];  // brick range in grid points
+    std::unordered_map<uint64_t, double> sdfs;  // grid point id -> sdf
+    std::unordered_map<uint64_t, int> edges;    // edge key -> vertex index
+    std::vector<Vector3> pos, nrm;
+    std::vector<uint64_t> keys;
+    std::vector<bool> shared;  // lies on the brick face, may be created by the neighbor brick too
+    std::vector<int> tris;
+};
+
+struct MeshWriter {
+    MeshFormat format;
+    std::ofstream out;
+    std::fstream faces;  // PLY faces must follow all vertices, so they are buffered in a temporary file
+    std::string faces_path;
+    long n_vertices = 0;
+    long n_triangles = 0;
+};
+
+static uint64_t point_id(long x, long y, long z){
+    return (uint64_t)x | ((uint64_t)y << 20) | ((uint64_t)z << 40);
+}
+
+static Vector3 point_pos(MeshGrid &grid, long x, long y, long z){
+    return Vector3(grid.o.x + x * grid.h, grid.o.y + y * grid.h, grid.o.z + z * grid.h);
+}
+
+static double point_sdf(Model &model, MeshGrid &grid, MeshArena &arena, long x, long y, long z){
+    uint64_t id = point_id(x, y, z);
+    auto it = arena.sdfs.find(id);
+    if(it != arena.sdfs.end()) return it->second;
+    double d = model.sdf(point_pos(grid, x, y, z));
+    arena.sdfs[id] = d;
+    return d;
+}
+
+static int edge_vertex(Model &model, MeshGrid &grid, MeshArena &arena, long c[8][3], double d[8], int a, int b){
+    // every edge of the tetrahedra goes from a corner to another whose bits are a superset
+    int l = ((a & b) == a) ? a : b;
+    int u = a ^ b ^ l;
+    int offset = a ^ b;
+    uint64_t key = (point_id(c[l][0], c[l][1], c[l][2]) << 3) | offset;
+    auto it = arena.edges.find(key);
+    if(it != arena.edges.end()) return it->second;
+
+    Vector3 p0 = point_pos(grid, c[l][0], c[l][1], c[l][2]);
+    Vector3 p1 = point_pos(grid, c[u][0], c[u][1], c[u][2]);
+    Vector3 v = p0 + (p1 - p0) * (d[l] / (d[l] - d[u]));
+    // Newton step, kept only when it gets closer to the surface
+    double sdf = model.sdf(v);
+    Vector3 refined = v - model.normal(v) * sdf;
+    if(std::abs(model.sdf(refined)) < std::abs(sdf)) v = refined;
+
+    bool shared = false;
+    for(int axis = 0; axis < 3; axis++){
+        if(!(offset >> axis & 1) && (c[l][axis] == arena.lo[axis] || c[l][axis] == arena.hi[axis])) shared = true;
+    }
+
+    int index = arena.pos.size();
+    arena.pos.push_back(v);
+    arena.nrm.push_back(model.normal(v));
+    arena.keys.push_back(key);
+    arena.shared.push_back(shared);
+    arena.edges[key] = index;
+    return index;
+}
+
+static void emit_triangle(Model &model, MeshGrid &grid, MeshArena &arena, long c[8][3], double d[8],
+    const int e[3][2], Vector3 &dir){
+    int i0 = edge_vertex(model, grid, arena, c, d, e[0][0], e[0][1]);
+    int i1 = edge_vertex(model, grid, arena, c, d, e[1][0], e[1][1]);
+    int i2 = edge_vertex(model, grid, arena, c, d, e[2][0], e[2][1]);
+    // face outward, from the inside corners to the outside corners
+    // edge midpoints are used since the vertices degenerate when the sdf of a corner is 0
+    Vector3 m[3] = {Vector3(0, 0, 0), Vector3(0, 0, 0), Vector3(0, 0, 0)};
+    for(int k = 0; k < 3; k++){
+        Vector3 pa = point_pos(grid, c[e[k][0]][0], c[e[k][0]][1], c[e[k][0]][2]);
+        Vector3 pb = point_pos(grid, c[e[k][1]][0], c[e[k][1]][1], c[e[k][1]][2]);
+        m[k] = (pa + pb) / 2;
+    }
+    if((m[1] - m[0]).cross(m[2] - m[0]).dot(dir) < 0) std::swap(i1, i2);
+    arena.tris.push_back(i0);
+    arena.tris.push_back(i1);
+    arena.tris.push_back(i2);
+}
+
+static void polygonize_cell(Model &model, MeshGrid &grid, MeshArena &arena, long x, long y, long z){
+    long c[8][3];
+    double d[8];
+    for(int k = 0; k < 8; k++){
+        c[k][0] = x + (k & 1); c[k][1] = y + (k >> 1 & 1); c[k][2] = z + (k >> 2 & 1);
+        d[k] = point_sdf(model, grid, arena, c[k][0], c[k][1], c[k][2]);
+    }
+    for(int t = 0; t < 6; t++){
+        int in[4], out[4];
+        int n_in = 0, n_out = 0;
+        Vector3 p_in(0, 0, 0), p_out(0, 0, 0);
+        for(int k = 0; k < 4; k++){
+            int corner = TETRAHEDRA[t][k];
+            Vector3 p = point_pos(grid, c[corner][0], c[corner][1], c[corner][2]);
+            if(d[corner] < 0){ in[n_in++] = corner; p_in += p; }
+            else{ out[n_out++] = corner; p_out += p; }
+        }
+        if(n_in == 0 || n_out == 0) continue;
+        Vector3 dir = p_out / n_out - p_in / n_in;
+
+        if(n_in == 1){
+            const int e[3][2] = {{in[0], out[0]}, {in[0], out[1]}, {in[0], out[2]}};
+            emit_triangle(model, grid, arena, c, d, e, dir);
+        }
+        else if(n_in == 3){
+            const int e[3][2] = {{out[0], in[0]}, {out[0], in[1]}, {out[0], in[2]}};
+            emit_triangle(model, grid, arena, c, d, e, dir);
+        }
+        else{
+            // quad (in0, out0) - (in0, out1) - (in1, out1) - (in1, out0)
+            const int e0[3][2] = {{in[0], out[0]}, {in[0], out[1]}, {in[1], out[1]}};
+            const int e1[3][2] = {{in[0], out[0]}, {in[1], out[1]}, {in[1], out[0]}};
+            emit_triangle(model, grid, arena, c, d, e0, dir);
+            emit_triangle(model, grid, arena, c, d, e1, dir);
+        }
+    }
+}
+
+static void descend(Model &model, MeshGrid &grid, MeshArena &arena, long x, long y, long z, long size){
+    double half = size * grid.h / 2;
+    Vector3 center = point_pos(grid, x, y, z) + Vector3(half, half, half);
+    if(std::abs(model.sdf(center)) > size * grid.h * std::sqrt(3.0)) return;
+    if(size == 1){
+        polygonize_cell(model, grid, arena, x, y, z);
+        return;
+    }
+    long s = size / 2;
+    for(int k = 0; k < 8; k++){
+        descend(model, grid, arena, x + (k & 1) * s, y + (k >> 1 & 1) * s, z + (k >> 2 & 1) * s, s);
+    }
+}
+
+static void write_header(MeshWriter &writer){
+    writer.out.seekp(0);
+    if(writer.format == MESH_PLY){
+        // counts have fixed width so that the header can be rewritten after streaming
+        char counts[64];
+        writer.out << "ply\n" << "format binary_little_endian 1.0\n";
+        std::snprintf(counts, sizeof(counts), "element vertex %012ld\n", writer.n_vertices);
+        writer.out << counts;
+        writer.out << "property float x\n" << "property float y\n" << "property float z\n";
+        writer.out << "property float nx\n" << "property float ny\n" << "property float nz\n";
+        std::snprintf(counts, sizeof(counts), "element face %012ld\n", writer.n_triangles);
+        writer.out << counts;
+        writer.out << "property list uchar int vertex_indices\n" << "end_header\n";
+    }
+    else{
+        char header[80] = "binary STL, function_renderer";
+        uint32_t n = (uint32_t)writer.n_triangles;
+        writer.out.write(header, sizeof(header));
+        writer.out.write((char*)&n, sizeof(n));
+    }
+}
+
+static void write_floats(std::ostream &out, Vector3 v){
+    float f[3] = {(float)v.x, (float)v.y, (float)v.z};
+    out.write((char*)f, sizeof(f));
+}
+
+static void write_brick(MeshWriter &writer, MeshArena &arena, std::unordered_map<uint64_t, long> &shared){
+    if(writer.format == MESH_STL){
+        uint16_t attribute = 0;
+        for(size_t t = 0; t < arena.tris.size(); t += 3){
+            Vector3 &v0 = arena.pos[arena.tris[t]];
+            Vector3 &v1 = arena.pos[arena.tris[t + 1]];
+            Vector3 &v2 = arena.pos[arena.tris[t + 2]];
+            write_floats(writer.out, (v1 - v0).cross(v2 - v0).normalize());
+            write_floats(writer.out, v0);
+            write_floats(writer.out, v1);
+            write_floats(writer.out, v2);
+            writer.out.write((char*)&attribute, sizeof(attribute));
+        }
+        writer.n_triangles += arena.tris.size() / 3;
+        return;
+    }
+
+    std::vector<long> global(arena.pos.size());
+    for(size_t v = 0; v < arena.pos.size(); v++){
+        if(arena.shared[v]){
+            auto it = shared.find(arena.keys[v]);
+            if(it != shared.end()){
+                global[v] = it->second;
+                continue;
+            }
+            shared[arena.keys[v]] = writer.n_vertices;
+        }
+        global[v] = writer.n_vertices++;
+        write_floats(writer.out, arena.pos[v]);
+        write_floats(writer.out, arena.nrm[v]);
+    }
+    unsigned char count = 3;
+    for(size_t t = 0; t < arena.tris.size(); t += 3){
+        int32_t face[3] = {(int32_t)global[arena.tris[t]], (int32_t)global[arena.tris[t + 1]],
+            (int32_t)global[arena.tris[t + 2]]};
+        writer.faces.write((char*)&count, sizeof(count));
+        writer.faces.write((char*)face, sizeof(face));
+    }
+    writer.n_triangles += arena.tris.size() / 3;
+}
+
+long extract_mesh(Model &model, Vector3 bbox_min, Vector3 bbox_max, int depth,
+    const std::string &path, MeshFormat format, bool logger){
+    assert(depth >= 0 && depth <= MESH_MAX_DEPTH);
+    double start = omp_get_wtime();
+
+    Vector3 extent = bbox_max - bbox_min;
+    long n = 1L << depth;
+    MeshGrid grid = { bbox_min, std::max(std::max(extent.x, extent.y), extent.z) / n };
+    long n_bricks = 1L << std::min(depth, BRICK_DEPTH);
+    long brick_size = n / n_bricks;
+
+    MeshWriter writer;
+    writer.format = format;
+    writer.out.open(path, std::ios::binary | std::ios::trunc);
+    if(!writer.out){
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return -1;
+    }
+    if(format == MESH_PLY){
+        writer.faces_path = path + ".faces.tmp";
+        writer.faces.open(writer.faces_path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        if(!writer.faces){
+            std::cerr << "Error: cannot open " << writer.faces_path << std::endl;
+            return -1;
+        }
+    }
+    write_header(writer);
+
+    // vertices on the brick faces, only the top face of the last layer is kept
+    std::unordered_map<uint64_t, long> shared;
+    for(long bz = 0; bz < n_bricks; bz++){
+        std::vector<MeshArena> arenas(n_bricks * n_bricks);
+        #pragma omp parallel for schedule(dynamic)
+        for(long b = 0; b < n_bricks * n_bricks; b++){
+            MeshArena &arena = arenas[b];
+            long lo[3] = {(b % n_bricks) * brick_size, (b / n_bricks) * brick_size, bz * brick_size};
+            for(int axis = 0; axis < 3; axis++){
+                arena.lo[axis] = lo[axis];
+                arena.hi[axis] = lo[axis] + brick_size;
+            }
+            descend(model, grid, arena, lo[0], lo[1], lo[2], brick_size);
+            std::unordered_map<uint64_t, double>().swap(arena.sdfs);
+            std::unordered_map<uint64_t, int>().swap(arena.edges);
+        }
+
+        for(MeshArena &arena : arenas) write_brick(writer, arena, shared);
+
+        long top = (bz + 1) * brick_size;
+        for(auto it = shared.begin(); it != shared.end();){
+            uint64_t key = it->first;
+            bool on_top = (long)((key >> 3) >> 40) == top && !(key & 4);
+            if(on_top) ++it;
+            else it = shared.erase(it);
+        }
+    }
+
+    if(format == MESH_PLY){
+        writer.faces.seekg(0);
+        if(writer.n_triangles > 0) writer.out << writer.faces.rdbuf();
+        writer.faces.close();
+        std::remove(writer.faces_path.c_str());
+    }
+    write_header(writer);
+    writer.out.close();
+
+    if(logger){
+        if(format == MESH_PLY) std::cout << "vertices: " << writer.n_vertices << " ";
+        std::cout << "triangles: " << writer.n_triangles << std::endl;
+        std::cout << "time: " << omp_get_wtime() - start << std::endl;
+    }
+    return writer.n_triangles;
+}
@@ -0,0 +1,17 @@
+#include <string>
+
+#include "model.h"
+#include "vector3.h"
+
+#ifndef _MESH_H_
+#define _MESH_H_
+
+enum MeshFormat { MESH_PLY, MESH_STL };
+
+// finest grid has 2^depth cells per axis, grid point coordinates must fit in 20 bits
+const int MESH_MAX_DEPTH = 19;
+
+long extract_mesh(Model &model, Vector3 bbox_min, Vector3 bbox_max, int depth,
+    const std::string &path, MeshFormat format, bool logger);
+
+#endif
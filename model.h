@@ -1,3 +1,5 @@
+#include <array>
+
 #include "vector3.h"
 
 #ifndef _MODEL_H_
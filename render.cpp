@@ -5,29 +5,90 @@
             : O(WHS) (S denotes the number of step)
         3. Matcap Texturing using ray direction and the normal of the model, with reference to Takikawa et al. 2021 : O(WH)
     These computation can be accelerated by parallel processing such as OpenMP or CUDA
+    render_views renders many cameras as one job, tiles of all views are scheduled together with OpenMP
 */
 
+#include <omp.h>
+
 #include "render.h"
 
 const int MAX_STEP = 100;
 const double FINISH_MINIMUM = 0.001;
 const double FINISH_MAXIMUM = 100;
+const int TILE_SIZE = 32;
 
 Vector3 camera_o = Vector3(1, 1, 1);
 Vector3 camera_t = Vector3(0, 0, 0);
 
-void decide_ray_direction(std::vector<std::vector<Vector3>> &ray_d, int width, int height){
-    Vector3 v_view = camera_t - camera_o;
-    Vector3 v_right = (v_view.x != 0 || v_view.y != 0) ? Vector3(-v_view.y, v_view.x, 0).normalize() : Vector3(1, 0, 0);
-    Vector3 v_up = v_right.cross(v_view).normalize();
+void camera_basis(Camera &camera, Vector3 &v_right, Vector3 &v_up){
+    Vector3 v_view = camera.t - camera.o;
+    v_right = (v_view.x != 0 || v_view.y != 0) ? Vector3(-v_view.y, v_view.x, 0).normalize() : Vector3(1, 0, 0);
+    v_up = v_right.cross(v_view).normalize();
+}
 
+Vector3 pixel_ray_direction(Camera &camera, Vector3 &v_right, Vector3 &v_up, int i, int j, int width, int height){
     double real_h = 5;
     double real_w = real_h * width / height;
+    Vector3 h_translate = v_up * (real_h * (i-height/2) / height);
+    Vector3 w_translate = v_right * (real_w * (j-width/2) / width);
+    return ((camera.t + h_translate + w_translate) - camera.o).normalize();
+}
+
+bool trace_ray(Model &model, Vector3 o, Vector3 d, Vector3 &nrm){
+    // John C. Hart 1995
+    Vector3 coord = o;
+    double sdf = model.sdf(coord);
+    double old_sdf = 1e18;
+    int step = 0;
+    while(step < MAX_STEP && sdf > FINISH_MINIMUM && (sdf - old_sdf) < FINISH_MAXIMUM){
+        coord += d * sdf;
+        old_sdf = sdf;
+        sdf = model.sdf(coord);
+        step += 1;
+    }
+    coord += d * sdf;
+    if(std::abs(sdf) <= FINISH_MINIMUM){
+        nrm = model.normal(coord);
+        return true;
+    }
+    return false;
+}
+
+void matcap_pixel(cv::Mat &image, cv::Mat &matcap_img, Vector3 ray_d, Vector3 nrm, bool collided, int i, int j){
+    if(collided){
+        // Takikawa et al. 2021
+        Vector3 ray_d_sc = Vector3(ray_d.x, ray_d.y, -ray_d.z);
+        double ray_d_n_dot = nrm.dot(ray_d_sc);
+        Vector3 r = ray_d_sc - nrm * ray_d_n_dot * 2.0;
+        r.z -= 1.0;
+        double m = 2 * r.norm();
+        double x = r.x / m + 0.5;
+        double y = r.y / m + 0.5;
+        x = 1 - x; y = 1 - y;
+        if(x < 0) x = 0; if (x > 1) x = 1;
+        if(y < 0) y = 0; if (y > 1) y = 1;
+        int x_ = (int)std::round(x * matcap_img.cols);
+        int y_ = (int)std::round(y * matcap_img.rows);
+
+        image.at<cv::Vec3b>(i, j)[0] = matcap_img.at<cv::Vec3b>(y_, x_)[0];
+        image.at<cv::Vec3b>(i, j)[1] = matcap_img.at<cv::Vec3b>(y_, x_)[1];
+        image.at<cv::Vec3b>(i, j)[2] = matcap_img.at<cv::Vec3b>(y_, x_)[2];
+    }
+    else{
+        image.at<cv::Vec3b>(i, j)[0] = 255;
+        image.at<cv::Vec3b>(i, j)[1] = 255;
+        image.at<cv::Vec3b>(i, j)[2] = 255;
+    }
+}
+
+void decide_ray_direction(std::vector<std::vector<Vector3>> &ray_d, int width, int height){
+    Camera camera = { camera_o, camera_t };
+    Vector3 v_right(0, 0, 0), v_up(0, 0, 0);
+    camera_basis(camera, v_right, v_up);
+
     for(int i = 0; i < height; i++){
-        Vector3 h_translate = v_up * (real_h * (i-height/2) / height);
         for(int j = 0; j < width; j++){
-            Vector3 w_translate = v_right * (real_w * (j-width/2) / width);
-            ray_d[i][j] = ((camera_t + h_translate + w_translate) - camera_o).normalize();
+            ray_d[i][j] = pixel_ray_direction(camera, v_right, v_up, i, j, width, height);
         }
     }
 }
@@ -35,63 +96,18 @@ void decide_ray_direction(std::vector<std::vector<Vector3>> &ray_d, int width, i
 void sphere_tracing(Model &model, std::vector<std::vector<Vector3>> &ray_d, std::vector<std::vector<Vector3>> &nrms, 
     std::vector<std::vector<bool>> &collided, int width, int height){
     // Sphere Tracer TODO: use cuda
-    std::vector<std::vector<Vector3>> coords(height, std::vector<Vector3>(width, camera_o));
-
-    long total_step = 0;
     for(int i = 0; i < height; i++){
         for(int j = 0; j < width; j++){
-            // John C. Hart 1995
-            double sdf = model.sdf(coords[i][j]);
-            double old_sdf = 1e18;
-            int step = 0;
-            while(step < MAX_STEP && sdf > FINISH_MINIMUM && (sdf - old_sdf) < FINISH_MAXIMUM){
-                // printf("\rtimes: %04d : %04d : %04d : %09ld", i, j, step, total_step);
-                // fflush(stdout);
-                coords[i][j] += ray_d[i][j] * sdf;
-                old_sdf = sdf;
-                sdf = model.sdf(coords[i][j]);
-                step += 1;
-                total_step += 1;
-            }
-            coords[i][j] += ray_d[i][j] * sdf;
-            if(std::abs(sdf) <= FINISH_MINIMUM){
-                collided[i][j] = true;
-                nrms[i][j] = model.normal(coords[i][j]);
-            }
+            collided[i][j] = trace_ray(model, camera_o, ray_d[i][j], nrms[i][j]);
         }
-        
     }
-    // printf("\n");
 }
 
 void matcap_texture(cv::Mat &image, cv::Mat &matcap_img, std::vector<std::vector<Vector3>> &ray_d,
     std::vector<std::vector<Vector3>> &nrms, std::vector<std::vector<bool>> &collided, int width, int height){
     for(int i = 0; i < height; i++){
         for(int j = 0; j < width; j++){
-            if(collided[i][j]){
-                // Takikawa et al. 2021
-                Vector3 ray_d_sc = Vector3(ray_d[i][j].x, ray_d[i][j].y, -ray_d[i][j].z);
-                double ray_d_n_dot = nrms[i][j].dot(ray_d_sc);
-                Vector3 r = ray_d_sc - nrms[i][j] * ray_d_n_dot * 2.0;
-                r.z -= 1.0;
-                double m = 2 * r.norm();
-                double x = r.x / m + 0.5;
-                double y = r.y / m + 0.5;
-                x = 1 - x; y = 1 - y;
-                if(x < 0) x = 0; if (x > 1) x = 1;
-                if(y < 0) y = 0; if (y > 1) y = 1;
-                int x_ = (int)std::round(x * matcap_img.cols);
-                int y_ = (int)std::round(y * matcap_img.rows);
-
-                image.at<cv::Vec3b>(i, j)[0] = matcap_img.at<cv::Vec3b>(y_, x_)[0];
-                image.at<cv::Vec3b>(i, j)[1] = matcap_img.at<cv::Vec3b>(y_, x_)[1];
-                image.at<cv::Vec3b>(i, j)[2] = matcap_img.at<cv::Vec3b>(y_, x_)[2];
-            }
-            else{
-                image.at<cv::Vec3b>(i, j)[0] = 255;
-                image.at<cv::Vec3b>(i, j)[1] = 255;
-                image.at<cv::Vec3b>(i, j)[2] = 255;
-            }
+            matcap_pixel(image, matcap_img, ray_d[i][j], nrms[i][j], collided[i][j], i, j);
         }
     }
 }
@@ -117,3 +133,67 @@ void render(cv::Mat &image, Model &model, cv::Mat &matcap_img, bool logger){
     clock_t end = clock();
     if(logger) std::cout << "time: " << (double)(end - start) / CLOCKS_PER_SEC << std::endl;
 }
+
+std::vector<Camera> canonical_cameras(Vector3 target, double distance){
+    // 6 faces, 12 edges and 8 corners of the cube around the target
+    std::vector<Camera> cameras;
+    for(int z = -1; z <= 1; z++){
+        for(int y = -1; y <= 1; y++){
+            for(int x = -1; x <= 1; x++){
+                if(x == 0 && y == 0 && z == 0) continue;
+                Vector3 dir = Vector3(x, y, z).normalize();
+                cameras.push_back({ target + dir * distance, target });
+            }
+        }
+    }
+    return cameras;
+}
+
+void render_views(std::vector<cv::Mat> &images, std::vector<Camera> &cameras, Model &model, cv::Mat &matcap_img,
+    int width, int height, bool logger){
+    double start = omp_get_wtime();
+    int n_views = cameras.size();
+
+    images.clear();
+    std::vector<Vector3> v_rights, v_ups;
+    for(int v = 0; v < n_views; v++){
+        images.push_back(cv::Mat(cv::Size(width, height), CV_8UC3));
+        Vector3 v_right(0, 0, 0), v_up(0, 0, 0);
+        camera_basis(cameras[v], v_right, v_up);
+        v_rights.push_back(v_right);
+        v_ups.push_back(v_up);
+    }
+
+    // tiles of all views share one queue, so that cheap views (mostly background) do not leave cores idle
+    int tiles_w = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_h = (height + TILE_SIZE - 1) / TILE_SIZE;
+    long tiles_per_view = (long)tiles_w * tiles_h;
+    #pragma omp parallel for schedule(dynamic)
+    for(long k = 0; k < tiles_per_view * n_views; k++){
+        int v = k / tiles_per_view;
+        int i0 = (k % tiles_per_view) / tiles_w * TILE_SIZE;
+        int j0 = (k % tiles_per_view) % tiles_w * TILE_SIZE;
+        for(int i = i0; i < std::min(i0 + TILE_SIZE, height); i++){
+            for(int j = j0; j < std::min(j0 + TILE_SIZE, width); j++){
+                Vector3 ray_d = pixel_ray_direction(cameras[v], v_rights[v], v_ups[v], i, j, width, height);
+                Vector3 nrm(0, 0, 0);
+                bool collided = trace_ray(model, cameras[v].o, ray_d, nrm);
+                matcap_pixel(images[v], matcap_img, ray_d, nrm, collided, i, j);
+            }
+        }
+    }
+
+    if(logger) std::cout << "views: " << n_views << " time: " << omp_get_wtime() - start << std::endl;
+}
+
+cv::Mat contact_sheet(std::vector<cv::Mat> &images, int cols){
+    if(images.empty()) return cv::Mat();
+    int rows = (images.size() + cols - 1) / cols;
+    int width = images[0].cols;
+    int height = images[0].rows;
+    cv::Mat sheet(cv::Size(width * cols, height * rows), CV_8UC3, cv::Scalar(255, 255, 255));
+    for(size_t v = 0; v < images.size(); v++){
+        images[v].copyTo(sheet(cv::Rect((v % cols) * width, (v / cols) * height, width, height)));
+    }
+    return sheet;
+}
@@ -8,6 +8,19 @@
 extern Vector3 camera_o;
 extern Vector3 camera_t;
 
+struct Camera {
+    Vector3 o;  // origin
+    Vector3 t;  // destination
+};
+
+void camera_basis(Camera &camera, Vector3 &v_right, Vector3 &v_up);
+
+Vector3 pixel_ray_direction(Camera &camera, Vector3 &v_right, Vector3 &v_up, int i, int j, int width, int height);
+
+bool trace_ray(Model &model, Vector3 o, Vector3 d, Vector3 &nrm);
+
+void matcap_pixel(cv::Mat &image, cv::Mat &matcap_img, Vector3 ray_d, Vector3 nrm, bool collided, int i, int j);
+
 void decide_ray_direction(std::vector<std::vector<Vector3>> &ray_d, int width, int height);
 
 void sphere_tracing(Model &model, std::vector<std::vector<Vector3>> &ray_d, std::vector<std::vector<Vector3>> &nrms, 
@@ -18,4 +31,11 @@ void matcap_texture(cv::Mat &image, cv::Mat &matcap_img, std::vector<std::vector
 
 void render(cv::Mat &image, Model &model, cv::Mat &matcap_img, bool logger);
 
+std::vector<Camera> canonical_cameras(Vector3 target, double distance);
+
+void render_views(std::vector<cv::Mat> &images, std::vector<Camera> &cameras, Model &model, cv::Mat &matcap_img,
+    int width, int height, bool logger);
+
+cv::Mat contact_sheet(std::vector<cv::Mat> &images, int cols);
+
 #endif